@@ -10,6 +10,11 @@ extern "C" {
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+    #define AHTTP_USE_SSE2
+    #include <emmintrin.h>
+#endif
+
 typedef enum http_parser_state {
     PARSER_START,
 
@@ -29,6 +34,7 @@ typedef enum http_parser_state {
     PARSER_RES_REASON,
 
     PARSER_REQ_METHOD,
+    PARSER_REQ_URI_START,
     PARSER_REQ_URI,
 
     PARSER_HEADERS,
@@ -60,7 +66,8 @@ enum http_parser_error {
     PARSER_INVALID_HTTP_METHOD,
     PARSER_EXPECT_NUMBER,
     PARSER_EXPECT_COLON,
-    PARSER_EXPECT_HEADER_VALUE
+    PARSER_EXPECT_HEADER_VALUE,
+    PARSER_UNEXPECTED_END
 };
 
 http_parser http_parser_init(const char* source, int length) {
@@ -70,8 +77,11 @@ http_parser http_parser_init(const char* source, int length) {
     parser.source = source;
     parser.length = length;
 
+    parser.start = source;
     parser.curr = source;
+
     parser.current_state = PARSER_START;
+    parser.prev_state = PARSER_START;
 
     parser.http_major = 0;
     parser.http_minor = 0;
@@ -85,6 +95,78 @@ http_parser http_parser_init(const char* source, int length) {
     return parser;
 }
 
+/* the compact state must fit in a quarter of a cache line */
+typedef char http_parser_compact_size_check[sizeof(http_parser_compact) <= 16 ? 1 : -1];
+
+/* the states must fit in the 5 bits of the compact state */
+typedef char http_parser_compact_state_check[PARSER_END < 32 ? 1 : -1];
+
+http_parser_compact http_parser_compact_init(void) {
+
+    http_parser_compact state;
+
+    state.offset = 0;
+    state.mark = 0;
+
+    state.current_state = PARSER_START;
+    state.prev_state = PARSER_START;
+
+    state.http_major = 0;
+    state.http_minor = 0;
+
+    state.status = -1;
+    state.method = HTTP_INVALID + 1;
+
+    state.error = PARSER_NO_ERROR;
+
+    return state;
+}
+
+http_parser http_parser_restore(const http_parser_compact* restrict state,
+                                const char* source,
+                                int length) {
+
+    http_parser parser;
+
+    parser.source = source;
+    parser.length = length;
+
+    parser.start = source + state->mark;
+    parser.curr = source + state->offset;
+
+    parser.current_state = state->current_state;
+    parser.prev_state = state->prev_state;
+
+    parser.http_major = state->http_major;
+    parser.http_minor = state->http_minor;
+
+    parser.status = state->status;
+    parser.method = (http_method)((int)state->method - 1);
+
+    parser.data = NULL;
+    parser.errno = state->error;
+
+    return parser;
+}
+
+void http_parser_save(const http_parser* restrict parser,
+                      http_parser_compact* restrict state) {
+
+    state->offset = (uint32_t)(parser->curr - parser->source);
+    state->mark = (uint32_t)(parser->start - parser->source);
+
+    state->current_state = parser->current_state;
+    state->prev_state = parser->prev_state;
+
+    state->http_major = parser->http_major;
+    state->http_minor = parser->http_minor;
+
+    state->status = parser->status;
+    state->method = (unsigned int)(parser->method + 1);
+
+    state->error = parser->errno;
+}
+
 uint8_t parser_http_minor_version(const http_parser* restrict parser) {
     return parser->http_minor;
 }
@@ -105,6 +187,10 @@ bool parser_had_error(const http_parser* restrict parser) {
     return parser->errno != PARSER_NO_ERROR;
 }
 
+bool parser_is_incomplete(const http_parser* restrict parser) {
+    return parser->errno == PARSER_UNEXPECTED_END;
+}
+
 const char* parser_get_error(const http_parser* restrict parser) {
 
     static const char *const http_parser_error_strings[] = {
@@ -117,7 +203,8 @@ const char* parser_get_error(const http_parser* restrict parser) {
         [PARSER_INVALID_HTTP_METHOD] = "Invalid HTTP method",
         [PARSER_EXPECT_NUMBER] = "Expected a number",
         [PARSER_EXPECT_COLON] = "Expected a colon character (':')",
-        [PARSER_EXPECT_HEADER_VALUE] = "Expected a header value"
+        [PARSER_EXPECT_HEADER_VALUE] = "Expected a header value",
+        [PARSER_UNEXPECTED_END] = "Unexpected end of input"
     };
 
     return http_parser_error_strings[parser->errno];
@@ -136,7 +223,9 @@ static inline char next_char(http_parser* restrict parser) {
 }
 
 static inline char peek(const http_parser* restrict parser) {
-    return *parser->curr;
+    return !is_at_end(parser)
+        ? *parser->curr
+        : '\0';
 }
 
 static inline bool match(http_parser* restrict parser, char c) {
@@ -194,9 +283,29 @@ static void parse_string(http_parser* restrict parser, bool allow_all) {
 /* <<< End Parser related functions */
 
 #define GET_PARSED_BYTES(parser) ((int)((parser)->curr - (parser)->source))
-#define THROW_ERROR(parser, err) do {           \
-        (parser)->errno = (err);              \
-        return GET_PARSED_BYTES(parser);        \
+/*
+ * Running out of input is not an error of the message: the cursor goes back
+ * to where the current state started, so that the state can be run again
+ * from the beginning once more data is available.
+ */
+#define THROW_ERROR(parser, err) do {                   \
+        if(is_at_end(parser)) {                         \
+            (parser)->curr = state_start;               \
+            (parser)->errno = PARSER_UNEXPECTED_END;    \
+        } else {                                        \
+            (parser)->errno = (err);                    \
+        }                                               \
+        return GET_PARSED_BYTES(parser);                \
+    } while(0)
+
+/*
+ * Open-ended tokens (URI, reason phrase, header name and value) keep the
+ * cursor where the scan stopped instead: their start is kept in `start`,
+ * so the next call carries on scanning from there without going back.
+ */
+#define SUSPEND(parser) do {                            \
+        (parser)->errno = PARSER_UNEXPECTED_END;        \
+        return GET_PARSED_BYTES(parser);                \
     } while(0)
 
 #define MARK_START(parser) (parser->start = parser->curr)
@@ -212,6 +321,8 @@ int http_parser_run(http_parser* restrict parser,
 
     while (parser->current_state != PARSER_END) {
 
+        const char* state_start = parser->curr;
+
         switch (parser->current_state) {
             case PARSER_START:
                 update_parser_state(parser, is_request
@@ -232,7 +343,7 @@ int http_parser_run(http_parser* restrict parser,
                             next_state = PARSER_RES_REASON;
                             break;
                         case PARSER_REQ_METHOD:
-                            next_state = PARSER_REQ_URI;
+                            next_state = PARSER_REQ_URI_START;
                             break;
                         case PARSER_REQ_URI:
                             next_state = PARSER_HTTP;
@@ -327,7 +438,8 @@ int http_parser_run(http_parser* restrict parser,
                 update_parser_state(parser, is_request ? PARSER_CRLF : PARSER_SP);
                 break;
             case PARSER_RES_STATUS:
-                if(parse_integer(parser, &parser->status)) {
+                parser->status = 0;
+                if(parse_integer(parser, &parser->status) && !is_at_end(parser)) {
                     update_parser_state(parser, PARSER_SP);
                 } else {
                     THROW_ERROR(parser, PARSER_INVALID_STATUS_CODE);
@@ -340,7 +452,7 @@ int http_parser_run(http_parser* restrict parser,
                 }
 
                 if(is_at_end(parser)) {
-                    THROW_ERROR(parser, PARSER_EXPECT_CRLF);
+                    SUSPEND(parser);
                 }
 
                 update_parser_state(parser, PARSER_CRLF);
@@ -408,15 +520,17 @@ int http_parser_run(http_parser* restrict parser,
 
                 break;
             }
-            case PARSER_REQ_URI:
-
+            case PARSER_REQ_URI_START:
                 MARK_START(parser);
+                update_parser_state(parser, PARSER_REQ_URI);
+                break;
+            case PARSER_REQ_URI:
                 while(peek(parser) != ' ' && !is_at_end(parser)) {
                     next_char(parser);
                 }
 
                 if(is_at_end(parser)) {
-                    THROW_ERROR(parser, PARSER_EXPECT_SPACE);
+                    SUSPEND(parser);
                 }
 
                 if(settings->on_req_uri != NULL) {
@@ -430,6 +544,10 @@ int http_parser_run(http_parser* restrict parser,
                 break;
             case PARSER_HEADER_START: {
 
+                if(is_at_end(parser)) {
+                    THROW_ERROR(parser, PARSER_UNEXPECTED_END);
+                }
+
                 if(peek(parser) == '\r') {
                     update_parser_state(parser, PARSER_HEADERS_DONE);
                     break;
@@ -448,6 +566,11 @@ int http_parser_run(http_parser* restrict parser,
                 break;
             case PARSER_HEADER_NAME:
                 parse_string(parser, /* allow_all */ false);
+
+                if(is_at_end(parser)) {
+                    SUSPEND(parser);
+                }
+
                 update_parser_state(parser, PARSER_HEADER_NAME_END);
                 break;
             case PARSER_HEADER_NAME_END: {
@@ -485,11 +608,22 @@ int http_parser_run(http_parser* restrict parser,
                 break;
             case PARSER_HEADER_VALUE:
                 parse_string(parser, /* allow_all */ true);
+
+                if(is_at_end(parser)) {
+                    SUSPEND(parser);
+                }
+
                 update_parser_state(parser, PARSER_HEADER_VALUE_LWS);
                 break;
             case PARSER_HEADER_VALUE_LWS: {
                 
                 if(match_chars(parser, "\r\n")) {
+
+                    // a continuation line may still follow
+                    if(is_at_end(parser)) {
+                        THROW_ERROR(parser, PARSER_UNEXPECTED_END);
+                    }
+
                     if(match(parser, ' ') || match(parser, '\t')) {
                         update_parser_state(parser, PARSER_HEADER_VALUE);
                     } else {
@@ -544,6 +678,160 @@ int http_parser_run(http_parser* restrict parser,
     return GET_PARSED_BYTES(parser);
 }
 
+int http_parser_compact_run(http_parser_compact* restrict state,
+                            const char* source,
+                            int length,
+                            void* data,
+                            http_parser_settings* settings,
+                            http_parser_type type) {
+
+    http_parser parser = http_parser_restore(state, source, length);
+
+    if(parser_had_error(&parser)) {
+
+        // a malformed message stays failed
+        if(!parser_is_incomplete(&parser)) {
+            return GET_PARSED_BYTES(&parser);
+        }
+
+        // the previous call only ran out of input: resume where it stopped
+        parser.errno = PARSER_NO_ERROR;
+    }
+
+    const int parsed = http_parser_run(&parser, data, settings, type);
+
+    http_parser_save(&parser, state);
+    return parsed;
+}
+
+/* >>> Cookie related functions */
+
+/* Returns the first occurrence of `c`, or `end` if there is none. */
+static inline const char* find_char(const char* curr, const char* end, char c) {
+    if(curr >= end) {
+        return end;
+    }
+
+    const char* found = (const char*)memchr(curr, c, (size_t)(end - curr));
+    return found != NULL ? found : end;
+}
+
+/* Returns the first occurrence of `a` or `b`, or `end` if there is none. */
+static const char* find_either(const char* curr, const char* end, char a, char b) {
+
+#ifdef AHTTP_USE_SSE2
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+
+    while(end - curr >= 16) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i*)curr);
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va),
+                                                        _mm_cmpeq_epi8(chunk, vb)));
+        if(mask != 0) {
+            return curr + __builtin_ctz(mask);
+        }
+
+        curr += 16;
+    }
+#endif
+
+    while(curr < end && *curr != a && *curr != b) {
+        curr++;
+    }
+
+    return curr;
+}
+
+static inline bool is_cookie_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static inline const char* skip_cookie_spaces(const char* curr, const char* end) {
+    while(curr < end && is_cookie_space(*curr)) {
+        curr++;
+    }
+
+    return curr;
+}
+
+static inline int trimmed_cookie_length(const char* start, const char* end) {
+    while(end > start && is_cookie_space(end[-1])) {
+        end--;
+    }
+
+    return (int)(end - start);
+}
+
+http_cookie_iter http_cookie_iter_init(const char* at, int length) {
+
+    http_cookie_iter iter;
+
+    iter.curr = at;
+    iter.end = at + length;
+
+    return iter;
+}
+
+bool http_cookie_next(http_cookie_iter* restrict iter, http_cookie* cookie) {
+
+    const char* curr = iter->curr;
+    const char* end = iter->end;
+
+    for(;;) {
+        curr = skip_cookie_spaces(curr, end);
+
+        if(curr >= end) {
+            iter->curr = end;
+            return false;
+        }
+
+        // skip empty pairs (e.g. "a=1;;b=2")
+        if(*curr != ';') {
+            break;
+        }
+
+        curr++;
+    }
+
+    const char* delim = find_either(curr, end, '=', ';');
+
+    cookie->name = curr;
+    cookie->name_length = trimmed_cookie_length(curr, delim);
+
+    if(delim < end && *delim == '=') {
+        // '=' may appear inside the value (e.g. base64 padding)
+        const char* value = skip_cookie_spaces(delim + 1, end);
+        delim = find_char(value, end, ';');
+
+        cookie->value = value;
+        cookie->value_length = trimmed_cookie_length(value, delim);
+    } else {
+        cookie->value = delim;
+        cookie->value_length = 0;
+    }
+
+    iter->curr = delim < end ? delim + 1 : end;
+    return true;
+}
+
+bool http_cookie_find(const char* at, int length,
+                      const char* name, int name_length,
+                      http_cookie* cookie) {
+
+    http_cookie_iter iter = http_cookie_iter_init(at, length);
+
+    while(http_cookie_next(&iter, cookie)) {
+        if(cookie->name_length == name_length &&
+           memcmp(cookie->name, name, name_length) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* <<< End Cookie related functions */
+
 #ifdef __cplusplus
 }
 #endif
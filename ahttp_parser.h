@@ -63,6 +63,29 @@ struct http_parser {
     void* data;
 };
 
+/*
+ * Compact persistent state of a parser (16 bytes), meant to be stored per
+ * connection. Positions are kept as offsets into the source buffer, so the
+ * buffer may be moved between calls. The `http_parser` struct is rebuilt
+ * from it on every `http_parser_compact_run` call, which resumes a message
+ * that was cut short by the end of the previous input.
+ */
+typedef struct http_parser_compact {
+    uint32_t offset; // curr - source
+    uint32_t mark;   // start - source
+
+    unsigned int current_state : 5;
+    unsigned int prev_state : 5;
+
+    unsigned int http_major : 4;
+    unsigned int http_minor : 4;
+
+    unsigned int method : 4; // http_method + 1
+    unsigned int error : 4;
+
+    int32_t status;
+} http_parser_compact;
+
 typedef struct http_parser_settings {
     ahttp_data_cb on_req_uri;
 
@@ -86,9 +109,45 @@ int http_parser_run(http_parser* restrict parser,
                     http_parser_settings* settings,
                     http_parser_type type);
 
+http_parser_compact http_parser_compact_init(void);
+
+http_parser http_parser_restore(const http_parser_compact* restrict state,
+                                const char* source,
+                                int length);
+void http_parser_save(const http_parser* restrict parser,
+                      http_parser_compact* restrict state);
+
+int http_parser_compact_run(http_parser_compact* restrict state,
+                            const char* source,
+                            int length,
+                            void* data,
+                            http_parser_settings* settings,
+                            http_parser_type type);
+
 bool parser_had_error(const http_parser* restrict parser);
+bool parser_is_incomplete(const http_parser* restrict parser);
 const char* parser_get_error(const http_parser* restrict parser);
 
+typedef struct http_cookie {
+    const char* name;
+    int name_length;
+
+    const char* value;
+    int value_length;
+} http_cookie;
+
+typedef struct http_cookie_iter {
+    const char* curr;
+    const char* end;
+} http_cookie_iter;
+
+http_cookie_iter http_cookie_iter_init(const char* at, int length);
+bool http_cookie_next(http_cookie_iter* restrict iter, http_cookie* cookie);
+
+bool http_cookie_find(const char* at, int length,
+                      const char* name, int name_length,
+                      http_cookie* cookie);
+
 #ifdef __cplusplus
 }
 #endif
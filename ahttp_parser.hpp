@@ -0,0 +1,623 @@
+#ifndef _AHTTP_PARSER_HPP_
+#define _AHTTP_PARSER_HPP_
+
+/*
+ * C++20 coroutine adapter for ahttp-parser.
+ *
+ * `ahttp::parse` turns `http_parser_run` into a lazy stream of typed events.
+ * When the input runs out the stream yields `event_type::need_input` instead
+ * of failing, so the caller can read more bytes (e.g. `co_await` a socket)
+ * and keep iterating. Coroutine frames are placed in a `frame_arena`, never
+ * on the heap.
+ */
+
+// must come before any standard header that may define the errno macro
+#include "ahttp_parser.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <string_view>
+#include <utility>
+
+namespace ahttp {
+
+enum class event_type {
+    need_input,
+
+    request_line,       // method, uri, version
+    status_line,        // status, version
+    header,             // name, value
+    headers_done,
+    body,               // value, one or more per message
+    message_complete,   // value holds the buffered bytes after the message
+
+    error               // value holds the error message
+};
+
+struct event {
+    event_type type;
+
+    std::string_view name{};
+    std::string_view value{};
+
+    http_method method = HTTP_INVALID;
+    int status = -1;
+
+    uint8_t http_major = 0;
+    uint8_t http_minor = 0;
+};
+
+/* >>> Input buffer */
+
+/*
+ * Fixed storage the adapter parses from. The storage is never reallocated,
+ * so the spans inside the yielded events stay valid until the buffer is
+ * consumed or reset.
+ * One byte is kept as a '\0' sentinel after the data.
+ */
+class input_buffer {
+public:
+    input_buffer(char* storage, std::size_t capacity) noexcept
+        : storage_(storage), capacity_(capacity), size_(0) {
+        storage_[0] = '\0';
+    }
+
+    const char* data() const noexcept { return storage_; }
+    std::size_t size() const noexcept { return size_; }
+    bool full() const noexcept { return size_ + 1 >= capacity_; }
+
+    // writable area for the next read
+    char* prepare() noexcept { return storage_ + size_; }
+    std::size_t available() const noexcept { return capacity_ - size_ - 1; }
+
+    void commit(std::size_t length) noexcept {
+        size_ += length;
+        storage_[size_] = '\0';
+    }
+
+    // drops the first `length` bytes, e.g. a parsed message, and keeps the rest
+    void consume(std::size_t length) noexcept {
+        if(length >= size_) {
+            reset();
+            return;
+        }
+
+        size_ -= length;
+        std::memmove(storage_, storage_ + length, size_);
+        storage_[size_] = '\0';
+    }
+
+    void reset() noexcept {
+        size_ = 0;
+        storage_[0] = '\0';
+    }
+
+private:
+    char* storage_;
+    std::size_t capacity_;
+    std::size_t size_;
+};
+
+/* <<< End Input buffer */
+
+/* >>> Frame allocation */
+
+/*
+ * Single-slot allocator for coroutine frames. A connection owns one arena and
+ * runs one `parse` stream at a time on it, so the slot is reused for every
+ * message and the steady state does no heap allocation.
+ */
+class frame_resource {
+public:
+    frame_resource(void* storage, std::size_t size) noexcept
+        : storage_(storage), size_(size), largest_request_(0), in_use_(false) {}
+
+    frame_resource(const frame_resource&) = delete;
+    frame_resource& operator=(const frame_resource&) = delete;
+
+    void* allocate(std::size_t size) noexcept {
+        if(size > largest_request_) {
+            largest_request_ = size;
+        }
+
+        if(in_use_ || size > size_) {
+            return nullptr;
+        }
+
+        in_use_ = true;
+        return storage_;
+    }
+
+    void deallocate(void* ptr) noexcept {
+        if(ptr == storage_) {
+            in_use_ = false;
+        }
+    }
+
+    std::size_t capacity() const noexcept { return size_; }
+
+    // largest frame requested so far, to size the arena
+    std::size_t largest_request() const noexcept { return largest_request_; }
+
+private:
+    void* storage_;
+    std::size_t size_;
+    std::size_t largest_request_;
+    bool in_use_;
+};
+
+template <std::size_t Size = 3072>
+class frame_arena : public frame_resource {
+public:
+    frame_arena() noexcept : frame_resource(storage_, Size) {}
+
+private:
+    alignas(std::max_align_t) unsigned char storage_[Size];
+};
+
+/* <<< End Frame allocation */
+
+/* >>> Event stream */
+
+namespace detail {
+
+// yielded instead of the parse events when the frame does not fit into the arena
+inline constexpr event allocation_failure{
+    event_type::error, {}, "Coroutine frame does not fit into the arena"
+};
+
+} // namespace detail
+
+class event_stream {
+public:
+    struct promise_type {
+        const event* current = nullptr;
+
+        // the arena pointer is stored in front of the frame so that
+        // operator delete can find it again
+        static constexpr std::size_t header_size = alignof(std::max_align_t);
+
+        template <typename... Args>
+        static void* operator new(std::size_t size, frame_resource& arena, Args&...) noexcept {
+            unsigned char* mem = static_cast<unsigned char*>(arena.allocate(size + header_size));
+            if(mem == nullptr) {
+                return nullptr;
+            }
+
+            ::new (static_cast<void*>(mem)) frame_resource*(&arena);
+            return mem + header_size;
+        }
+
+        static void operator delete(void* ptr, std::size_t) noexcept {
+            unsigned char* mem = static_cast<unsigned char*>(ptr) - header_size;
+            (*reinterpret_cast<frame_resource**>(mem))->deallocate(mem);
+        }
+
+        static event_stream get_return_object_on_allocation_failure() noexcept {
+            return event_stream(nullptr);
+        }
+
+        event_stream get_return_object() noexcept {
+            return event_stream(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        std::suspend_always yield_value(const event& ev) noexcept {
+            current = &ev;
+            return {};
+        }
+
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {}
+    };
+
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    class iterator {
+    public:
+        explicit iterator(handle_type handle, const event* failure = nullptr) noexcept
+            : handle_(handle), failure_(failure) {}
+
+        const event& operator*() const noexcept { return *operator->(); }
+        const event* operator->() const noexcept {
+            return failure_ != nullptr ? failure_ : handle_.promise().current;
+        }
+
+        iterator& operator++() noexcept {
+            if(failure_ != nullptr) {
+                failure_ = nullptr;
+                return *this;
+            }
+
+            handle_.resume();
+            if(handle_.done()) {
+                handle_ = nullptr;
+            }
+
+            return *this;
+        }
+
+        bool operator==(std::default_sentinel_t) const noexcept {
+            return !handle_ && failure_ == nullptr;
+        }
+
+    private:
+        handle_type handle_;
+        const event* failure_;
+    };
+
+    event_stream(event_stream&& other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    event_stream& operator=(event_stream&& other) noexcept {
+        if(this != &other) {
+            destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~event_stream() { destroy(); }
+
+    // false when the frame did not fit into the arena, the stream then
+    // yields a single error event
+    bool valid() const noexcept { return static_cast<bool>(handle_); }
+
+    iterator begin() noexcept {
+        if(!handle_) {
+            return iterator(nullptr, &detail::allocation_failure);
+        }
+
+        iterator it(handle_);
+        return ++it;
+    }
+
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+    explicit event_stream(handle_type handle) noexcept : handle_(handle) {}
+
+    void destroy() noexcept {
+        if(handle_) {
+            handle_.destroy();
+            handle_ = nullptr;
+        }
+    }
+
+    handle_type handle_;
+};
+
+/* <<< End Event stream */
+
+namespace detail {
+
+// what the callbacks need to remember between passes
+struct message_state {
+    bool start_line_sent = false;
+
+    std::string_view uri{};
+    std::string_view header_name{};
+
+    std::size_t content_length = 0;
+    bool has_length = false;
+    bool invalid_length = false;
+
+    // any transfer coding but identity
+    bool transfer_encoded = false;
+
+    const char* body = nullptr;
+};
+
+inline bool equals_ignore_case(std::string_view a, std::string_view b) noexcept {
+    if(a.size() != b.size()) {
+        return false;
+    }
+
+    for(std::size_t i = 0; i < a.size(); i++) {
+        char x = a[i];
+        char y = b[i];
+
+        if(x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if(y >= 'A' && y <= 'Z') y += 'a' - 'A';
+
+        if(x != y) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline bool parse_content_length(std::string_view value, std::size_t* result) noexcept {
+    if(value.empty()) {
+        return false;
+    }
+
+    std::size_t length = 0;
+
+    for(char c : value) {
+        if(c < '0' || c > '9' || length > (static_cast<std::size_t>(-1) - 9) / 10) {
+            return false;
+        }
+
+        length = length * 10 + static_cast<std::size_t>(c - '0');
+    }
+
+    *result = length;
+    return true;
+}
+
+/*
+ * Collects the callbacks of one `http_parser_compact_run` pass. If a pass
+ * produces more events than fit, it is run again from the state it started
+ * with, skipping the events that were already yielded.
+ */
+struct collector {
+    static constexpr int capacity = 8;
+
+    // new bytes given to one pass, so a replay rescans at most this many
+    static constexpr std::size_t window = 256;
+
+    event events[capacity];
+    int count;
+
+    int skip;
+    int seen;
+
+    bool truncated;
+
+    message_state message;
+
+    void begin_pass(int already_yielded) noexcept {
+        count = 0;
+        skip = already_yielded;
+        seen = 0;
+        truncated = false;
+    }
+
+    void push(const event& ev) noexcept {
+        if(seen++ < skip) {
+            return;
+        }
+
+        if(count == capacity) {
+            truncated = true;
+            return;
+        }
+
+        events[count++] = ev;
+    }
+
+    void push_start_line(const http_parser* parser) noexcept {
+        if(message.start_line_sent) {
+            return;
+        }
+
+        message.start_line_sent = true;
+
+        event ev{};
+        ev.http_major = parser_http_major_version(parser);
+        ev.http_minor = parser_http_minor_version(parser);
+
+        if(parser_http_method(parser) != HTTP_INVALID) {
+            ev.type = event_type::request_line;
+            ev.method = parser_http_method(parser);
+            ev.value = message.uri;
+        } else {
+            ev.type = event_type::status_line;
+            ev.status = parser_http_status_code(parser);
+        }
+
+        push(ev);
+    }
+};
+
+inline collector* get_collector(http_parser* parser) {
+    return static_cast<collector*>(parser->data);
+}
+
+inline void on_req_uri(http_parser* parser, const char* at, int length) {
+    get_collector(parser)->message.uri = std::string_view(at, length);
+}
+
+inline void on_header(http_parser* parser) {
+    get_collector(parser)->push_start_line(parser);
+}
+
+inline void on_header_name(http_parser* parser, const char* at, int length) {
+    get_collector(parser)->message.header_name = std::string_view(at, length);
+}
+
+inline void on_header_value(http_parser* parser, const char* at, int length) {
+    collector* c = get_collector(parser);
+
+    event ev{};
+    ev.type = event_type::header;
+    ev.name = c->message.header_name;
+    ev.value = std::string_view(at, length);
+
+    if(equals_ignore_case(ev.name, "Content-Length")) {
+        std::size_t length = 0;
+
+        // repeated headers must agree, otherwise the framing is ambiguous
+        if(!parse_content_length(ev.value, &length) ||
+           (c->message.has_length && length != c->message.content_length)) {
+            c->message.invalid_length = true;
+        }
+
+        c->message.content_length = length;
+        c->message.has_length = true;
+    } else if(equals_ignore_case(ev.name, "Transfer-Encoding")) {
+        if(!equals_ignore_case(ev.value, "identity")) {
+            c->message.transfer_encoded = true;
+        }
+    }
+
+    c->push(ev);
+}
+
+inline void on_headers_done(http_parser* parser) {
+    collector* c = get_collector(parser);
+
+    c->push_start_line(parser);
+
+    event ev{};
+    ev.type = event_type::headers_done;
+    c->push(ev);
+}
+
+// the core parser hands over all the buffered bytes, framing is done by parse
+inline void on_body(http_parser* parser, const char* at, int length) {
+    (void)length;
+    get_collector(parser)->message.body = at;
+}
+
+inline http_parser_settings collector_settings = {
+    on_req_uri,
+    on_header,
+    on_header_name,
+    on_header_value,
+    on_headers_done,
+    on_body
+};
+
+} // namespace detail
+
+// GCC pairs the frame's operator delete with the wrong operator new at -O0
+#if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+/*
+ * Lazily parses one HTTP message from `input`.
+ *
+ * Yields `need_input` whenever the buffered bytes end in the middle of the
+ * message; the caller must `commit` more data to `input` before advancing
+ * the stream again. Parsing then resumes from `http_parser_compact` state.
+ *
+ * The input is parsed in passes over at most `collector::window` new bytes.
+ * A pass that produces more events than the collector holds is replayed, so
+ * a byte is scanned once per `collector::capacity` events in its window;
+ * ordinary headers fit and are scanned once.
+ *
+ * The body is framed by `Content-Length`: `message_complete` is yielded once
+ * all of it was received. Without it the message has no body. Repeated
+ * `Content-Length` headers must agree. Transfer codings other than
+ * `identity` are not decoded and are reported as an error.
+ */
+inline event_stream parse(frame_resource& arena,
+                          input_buffer& input,
+                          http_parser_type type) {
+    (void)arena; // only used by promise_type::operator new
+
+    detail::collector collector;
+    http_parser_compact state = http_parser_compact_init();
+    std::size_t window_end = 0;
+
+    for(;;) {
+        window_end += detail::collector::window;
+        if(window_end > input.size()) {
+            window_end = input.size();
+        }
+
+        const int length = static_cast<int>(window_end);
+
+        const http_parser_compact pass_state = state;
+        const detail::message_state pass_message = collector.message;
+        int yielded = 0;
+
+        for(;;) {
+            collector.begin_pass(yielded);
+            http_parser_compact_run(&state, input.data(), length,
+                                    &collector, &detail::collector_settings, type);
+
+            for(int i = 0; i < collector.count; i++) {
+                co_yield collector.events[i];
+                yielded++;
+            }
+
+            if(!collector.truncated) {
+                break;
+            }
+
+            state = pass_state;
+            collector.message = pass_message;
+        }
+
+        const http_parser parser = http_parser_restore(&state, input.data(), length);
+
+        if(!parser_had_error(&parser)) {
+            break;
+        }
+
+        if(!parser_is_incomplete(&parser)) {
+            co_yield event{event_type::error, {}, parser_get_error(&parser)};
+            co_return;
+        }
+
+        if(window_end < input.size()) {
+            continue;
+        }
+
+        if(input.full()) {
+            co_yield event{event_type::error, {}, "Input buffer is full"};
+            co_return;
+        }
+
+        co_yield event{event_type::need_input};
+    }
+
+    detail::message_state& message = collector.message;
+
+    if(message.transfer_encoded) {
+        co_yield event{event_type::error, {}, "Transfer-Encoding is not supported"};
+        co_return;
+    }
+
+    if(message.invalid_length) {
+        co_yield event{event_type::error, {}, "Invalid Content-Length"};
+        co_return;
+    }
+
+    const char* body = message.body;
+    std::size_t remaining = message.content_length;
+
+    while(remaining > 0) {
+        const std::size_t available = input.size() - static_cast<std::size_t>(body - input.data());
+
+        if(available > 0) {
+            const std::size_t length = available < remaining ? available : remaining;
+
+            co_yield event{event_type::body, {}, std::string_view(body, length)};
+
+            body += length;
+            remaining -= length;
+            continue;
+        }
+
+        if(input.full()) {
+            co_yield event{event_type::error, {}, "Input buffer is full"};
+            co_return;
+        }
+
+        co_yield event{event_type::need_input};
+    }
+
+    const std::size_t rest = input.size() - static_cast<std::size_t>(body - input.data());
+    co_yield event{event_type::message_complete, {}, std::string_view(body, rest)};
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC diagnostic pop
+#endif
+
+} // namespace ahttp
+
+#endif
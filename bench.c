@@ -28,9 +28,187 @@ static const char request[] =
 
 static const int request_length = sizeof(request);
 
+static const char cookie_request[] =
+    "GET /dashboard HTTP/1.1\r\n"
+    "Host: github.com\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+    "image/webp,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Cookie: "
+    "_ga=GA1.2.447712782.1161973069; "
+    "_gid=GA1.2.523938499.1698935572; "
+    "_fbp=fb.1.1718000000000.151847156; "
+    "_hjSessionUser_123456=E0iGXlD6gNCFbaEPFjbD0kH8Oool8DklZDOCj2ISaJiHkTj0rLGlkoMXGjtEkDnNfribxUdl7dXTPyLsxPFkThf4VucSmEHgaKwVJ7faC9qEwjky40UVsWmflzdE1F8ResqEDusTpkr0cStY4qWB8dWKnHfDNxSIvPZZ63fFKcZjR4I0b3jR==; "
+    "_hjSession_123456=taWr4Y9OJFLJOqOAf1lLQSAJaiXnkU8Is2g8nprvDd53x83rzjZZZZGeoZDMENcKHVmDGAkJiG8XnBE3NnYJoQ9WmXeHH2fdeeTFJGvVvQe1sKhBN88hXJsi=; "
+    "OptanonConsent=isGpcEnabled=0&datestamp=Mon+Jun+10+2024&version=202405.1.0&groups=C0001%3A1%2CC0002%3A1%2CC0003%3A1%2CC0004%3A0&hosts=&consentId=6BwhTp3Fs2QhX6KWxOiixgVoOnzyw2MzP0Zv; "
+    "ajs_anonymous_id=zOMhfWuBByReQMsm9Wcz7uW9XFOGOeMVNen5; "
+    "ajs_user_id=n1Ae6pWzpF1qH6YytwMe4Lby; "
+    "intercom-device-id-abc123=oVFz8uZdZv8FuKKIBJl5dzpJn0meq7WJjjIB; "
+    "intercom-session-abc123=AzupGhv7Ib3M03NBQNSgPwlUQia1ID6vW5dql05ha064gIiJhgB3cxLmAxzJLJenuHjDUrhhjeyxG4jDPMRCxGgcjBw56EcUngmgMsRcgizeg8Psh4487Q7j58M1cIaHZcUEqPbENqTyH5xJ8tpqXJQ4I9dOv8GZ4fKq1OKtbgZVaMWUFuXBVjdctBYVhnSg9EH6yO4G==; "
+    "csrftoken=FQRC5xLRwI0b26r08QZJi6gkfsUFRDzsLb5ER8BoFzQFm2OEQ3HdAVja76RnICht; "
+    "preferences=lang%3Den%26theme%3Ddark%26tz%3DEurope%252FRome; "
+    "amplitude_id_fef1e872c952688acd962d30aa545b9e=eyJP8HKQDLM7ToThwNScgrLRWzBQCABugjMgeP7cGq0pbqfi14ZgTsNOVM14tuoIZWD1IAEov4QbKDFq1Y3gqSmPsSCdLKRcAQX9VjUPC94TNWLAVYFeRgpMPgxAFQ0FJZlCZBTToOFl9h2wJq5ty4mYwUufJSunpJC01t5gobuszgI6hwgk10zB0rlz5tr9spOFBCIoX9GY1cjDoBoirPfQAdzEv7g5iFqhEvveQzE2QPuwNOvpdf2YEe6rSxCnopMEmJVQpvsTnkIAeDfRrGsNrfSthSdddxH5jMTF7eBSdE0g9cRYN687NElFJvhQ8XIm0ogR4HtXOf54fZBKA8frcZTuJaWYUH1VAUwV1ZH; "
+    "__stripe_mid=87MtA5vSQXEZY3lEX7bwR2DRGD1qSo7JPRbgUMxXy9b4Bzwo; "
+    "__stripe_sid=Z648jjNuFD7uacnwIp3SfD67jIKeaVSTQvvpQZpPTejqZHKp; "
+    "cf_clearance=KENg5zfjOc6VwcbIjMPFLVjFUPXQzkM4Bv3aYavhNYRVwDfRk9XIrghoy32NFR5PYZpcb9T2039BICbtw5ze9lfAEZ7770h2dcPyGOJJhrG80usp2w5dFjxCAyIOk6CptT9IoQhobswHGETh8lMYQOymAAiTdR9Up14PehPjPB9atpTDBMf4rpaFQOqb7XOfCsVtaXrZMAzSv2gENfMTx0MOdOQw4SG8nfnL5Ofa6qD8mJ7Z; "
+    "_dd_s=rum=0&expire=1718000000000; "
+    "remember_token=DNBmJaDtDLZc5t4UuHF7KVMLp7hvdCTquY1XVcKGAFRFWa94Hj9wNYWx0T0zbFDteMXi6cMUXv5eBoaPzoxZCYCdEz6DQMvE5mVXRV99nCQvtsU7RTAuwm6zo88EB0OG; "
+    "session_id=et9d9xYyQ6b0fI7fLAz7vT0sxJmPU3UdXyymFgMZwKPaEpCejiUKb4GEQnFNGaft"
+    "\r\n"
+    "Connection: keep-alive\r\n\r\n";
+
+static const int cookie_request_length = sizeof(cookie_request);
+
 static http_parser_settings default_settings = {0};
 
-void run_bench(int iter_count) {
+/* >>> Cookie lookup callbacks */
+
+typedef struct cookie_lookup {
+    bool in_cookie;
+    http_cookie session;
+} cookie_lookup;
+
+static void on_cookie_header_name(http_parser* parser, const char* at, int length) {
+    cookie_lookup* lookup = (cookie_lookup*)parser->data;
+    lookup->in_cookie = length == 6 && memcmp(at, "Cookie", 6) == 0;
+}
+
+static void on_cookie_header_value(http_parser* parser, const char* at, int length) {
+    cookie_lookup* lookup = (cookie_lookup*)parser->data;
+
+    if(lookup->in_cookie) {
+        bool found = http_cookie_find(at, length, "session_id", 10, &lookup->session);
+        assert(found);
+        (void)found;
+    }
+}
+
+static http_parser_settings cookie_settings = {
+    .on_header_name = on_cookie_header_name,
+    .on_header_value = on_cookie_header_value
+};
+
+/* <<< End Cookie lookup callbacks */
+
+/* >>> Split message check */
+
+#define MAX_SPANS 64
+
+typedef struct span_log {
+    const char* source;
+
+    int count;
+    int spans[MAX_SPANS][3]; // callback, offset, length
+} span_log;
+
+static void log_span(http_parser* parser, int callback, const char* at, int length) {
+    span_log* log = (span_log*)parser->data;
+
+    assert(log->count < MAX_SPANS);
+
+    log->spans[log->count][0] = callback;
+    log->spans[log->count][1] = at != NULL ? (int)(at - log->source) : -1;
+    log->spans[log->count][2] = length;
+    log->count++;
+}
+
+static void log_req_uri(http_parser* parser, const char* at, int length) {
+    log_span(parser, 0, at, length);
+}
+
+static void log_header(http_parser* parser) {
+    log_span(parser, 1, NULL, 0);
+}
+
+static void log_header_name(http_parser* parser, const char* at, int length) {
+    log_span(parser, 2, at, length);
+}
+
+static void log_header_value(http_parser* parser, const char* at, int length) {
+    log_span(parser, 3, at, length);
+}
+
+static void log_headers_done(http_parser* parser) {
+    log_span(parser, 4, NULL, 0);
+}
+
+static void log_body(http_parser* parser, const char* at, int length) {
+    log_span(parser, 5, at, length);
+}
+
+static http_parser_settings log_settings = {
+    log_req_uri,
+    log_header,
+    log_header_name,
+    log_header_value,
+    log_headers_done,
+    log_body
+};
+
+/*
+ * Feeds the message through http_parser_compact_run split at every offset
+ * before the body, then one byte at a time, and checks that the spans match
+ * a single pass.
+ */
+void check_split_message(const char* source, int length, http_parser_type type) {
+
+    span_log expected = { source, 0, {{0}} };
+    span_log actual;
+
+    http_parser parser = http_parser_init(source, length);
+    int parsed = http_parser_run(&parser, &expected, &log_settings, type);
+    assert(parsed == length && !parser_had_error(&parser));
+
+    const int body_offset = expected.spans[expected.count - 1][1];
+
+    for (int split = 1; split < body_offset; split++) {
+        http_parser_compact state = http_parser_compact_init();
+
+        actual.source = source;
+        actual.count = 0;
+
+        http_parser_compact_run(&state, source, split, &actual, &log_settings, type);
+        parser = http_parser_restore(&state, source, split);
+        assert(parser_is_incomplete(&parser));
+
+        parsed = http_parser_compact_run(&state, source, length, &actual, &log_settings, type);
+        parser = http_parser_restore(&state, source, length);
+        assert(parsed == length && !parser_had_error(&parser));
+
+        assert(actual.count == expected.count);
+        assert(memcmp(actual.spans, expected.spans, sizeof(actual.spans[0]) * actual.count) == 0);
+    }
+
+    http_parser_compact state = http_parser_compact_init();
+
+    actual.source = source;
+    actual.count = 0;
+
+    for (int received = 1; received < body_offset; received++) {
+        http_parser_compact_run(&state, source, received, &actual, &log_settings, type);
+        parser = http_parser_restore(&state, source, received);
+        assert(parser_is_incomplete(&parser));
+    }
+
+    parsed = http_parser_compact_run(&state, source, length, &actual, &log_settings, type);
+    parser = http_parser_restore(&state, source, length);
+    assert(parsed == length && !parser_had_error(&parser));
+
+    assert(actual.count == expected.count);
+    assert(memcmp(actual.spans, expected.spans, sizeof(actual.spans[0]) * actual.count) == 0);
+
+    (void)parsed;
+    printf("split check passed (%d offsets, byte by byte)\n", body_offset - 1);
+    fflush(stdout);
+}
+
+/* <<< End Split message check */
+
+void run_bench(const char* source,
+               int length,
+               http_parser_settings* settings,
+               void* data,
+               int iter_count) {
     
     int err;
 
@@ -41,16 +219,16 @@ void run_bench(int iter_count) {
     int parsed;
 
 
-    printf( "request length = %d\n", request_length);
+    printf( "request length = %d\n", length);
 
     err = gettimeofday(&start, NULL);
     assert(err == 0);
 
     for (int i = 0; i < iter_count; i++) {
-        parser = http_parser_init(request, request_length);
+        parser = http_parser_init(source, length);
 
-        parsed = http_parser_run(&parser, NULL, &default_settings, HTTP_PARSER_REQUEST);
-        assert(parsed == request_length);
+        parsed = http_parser_run(&parser, data, settings, HTTP_PARSER_REQUEST);
+        assert(parsed == length);
     }
 
     double elapsed;
@@ -65,7 +243,7 @@ void run_bench(int iter_count) {
     elapsed = (double) (end.tv_sec - start.tv_sec) +
         (end.tv_usec - start.tv_usec) * 1e-6f;
 
-    total = (double) iter_count * request_length;
+    total = (double) iter_count * length;
     bw = (double) total / elapsed;
 
     printf("%.2f mb | %.2f mb/s | %.2f req/sec | %.2f s\n",
@@ -77,10 +255,26 @@ void run_bench(int iter_count) {
     fflush(stdout);
 }
 
+static const char response[] =
+    "HTTP/1.1 404 Not Found\r\n"
+    "Server: Apache\r\n"
+    "Content-Type: text/html;\r\n"
+    " charset=UTF-8\r\n"
+    "Content-Length: 5\r\n\r\n"
+    "hello";
+
 int main(void) {
 
-    const int iterations = bytes / request_length;
-    run_bench(iterations);
+    check_split_message(request, request_length, HTTP_PARSER_REQUEST);
+    check_split_message(cookie_request, cookie_request_length, HTTP_PARSER_REQUEST);
+    check_split_message(response, sizeof(response) - 1, HTTP_PARSER_RESPONSE);
+
+    run_bench(request, request_length, &default_settings, NULL,
+              bytes / request_length);
+
+    cookie_lookup lookup = {0};
+    run_bench(cookie_request, cookie_request_length, &cookie_settings, &lookup,
+              bytes / cookie_request_length);
 
     return 0;
 }
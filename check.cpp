@@ -0,0 +1,285 @@
+/*
+ * Checks for the C++20 coroutine adapter in ahttp_parser.hpp.
+ */
+
+#include "ahttp_parser.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+/* >>> Frame size check */
+
+// the frame must fit into the default arena with room to spare
+void check_frame_size() {
+    char storage[64];
+    ahttp::input_buffer input(storage, sizeof(storage));
+    ahttp::frame_arena<> arena;
+
+    {
+        ahttp::event_stream stream = ahttp::parse(arena, input, HTTP_PARSER_REQUEST);
+        assert(stream.valid());
+    }
+
+    assert(arena.largest_request() * 3 / 2 <= arena.capacity());
+
+    printf("frame check passed (%zu of %zu bytes)\n", arena.largest_request(), arena.capacity());
+    fflush(stdout);
+}
+
+/* <<< End Frame size check */
+
+/* >>> Keep-alive check */
+
+// hands out `source` in reads of at most `chunk` bytes, then 0 for EOF
+struct reader {
+    const char* source;
+    std::size_t length;
+    std::size_t chunk;
+    std::size_t offset;
+
+    std::size_t read(char* buffer, std::size_t capacity) {
+        std::size_t count = length - offset;
+        if(count > chunk) count = chunk;
+        if(count > capacity) count = capacity;
+
+        memcpy(buffer, source + offset, count);
+        offset += count;
+        return count;
+    }
+};
+
+// the per-connection loop from the README, until the peer closes the connection
+int serve_connection(reader& peer, ahttp::frame_resource& arena) {
+    char storage[512];
+    ahttp::input_buffer input(storage, sizeof(storage));
+
+    int messages = 0;
+
+    for(;;) {
+        for(const ahttp::event& ev : ahttp::parse(arena, input, HTTP_PARSER_REQUEST)) {
+            switch(ev.type) {
+                case ahttp::event_type::need_input: {
+                    std::size_t length = peer.read(input.prepare(), input.available());
+                    if(length == 0) {
+                        return messages;
+                    }
+
+                    input.commit(length);
+                    break;
+                }
+                case ahttp::event_type::message_complete:
+                    input.consume(input.size() - ev.value.size());
+                    messages++;
+                    break;
+                case ahttp::event_type::error:
+                    return -1;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+void check_keep_alive() {
+    static const char requests[] =
+        "POST /a HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+        "GET /b HTTP/1.1\r\nHost: localhost\r\n\r\n"
+        "GET /c HTTP/1.1\r\n\r\n";
+
+    ahttp::frame_arena<> arena;
+
+    for(std::size_t chunk = 1; chunk <= sizeof(requests); chunk++) {
+        reader peer = { requests, sizeof(requests) - 1, chunk, 0 };
+        assert(serve_connection(peer, arena) == 3);
+    }
+
+    printf("keep-alive check passed (%zu read sizes)\n", sizeof(requests));
+    fflush(stdout);
+}
+
+/* <<< End Keep-alive check */
+
+/* >>> Split input check */
+
+// what one message parsed into, with the body events joined
+struct message_log {
+    int need_input = 0;
+    int headers = 0;
+
+    std::string events;
+    std::string body;
+    std::string rest;
+};
+
+message_log parse_in_reads(const char* source, std::size_t length, std::size_t chunk) {
+    static char storage[4096];
+    ahttp::input_buffer input(storage, sizeof(storage));
+    ahttp::frame_arena<> arena;
+
+    reader peer = { source, length, chunk, 0 };
+    message_log log;
+
+    for(const ahttp::event& ev : ahttp::parse(arena, input, HTTP_PARSER_REQUEST)) {
+        switch(ev.type) {
+            case ahttp::event_type::need_input: {
+                std::size_t count = peer.read(input.prepare(), input.available());
+                assert(count > 0);
+
+                input.commit(count);
+                log.need_input++;
+                break;
+            }
+            case ahttp::event_type::request_line:
+                log.events += "request_line " + std::string(ev.value) + "\n";
+                break;
+            case ahttp::event_type::header:
+                log.events += std::string(ev.name) + ": " + std::string(ev.value) + "\n";
+                log.headers++;
+                break;
+            case ahttp::event_type::headers_done:
+                log.events += "headers_done\n";
+                break;
+            case ahttp::event_type::body:
+                log.body += ev.value;
+                break;
+            case ahttp::event_type::message_complete:
+                log.rest = ev.value;
+                break;
+            default:
+                assert(!"unexpected event");
+        }
+    }
+
+    return log;
+}
+
+/*
+ * Feeds a request with more headers than the collector holds, spanning
+ * several windows, in reads of every size and compares with one read.
+ */
+void check_split_input() {
+    std::string request = "POST /upload?id=7 HTTP/1.1\r\n";
+
+    for(int i = 0; i < 40; i++) {
+        request += "X-Header-" + std::to_string(i) + ": value " + std::to_string(i) + "\r\n";
+    }
+
+    const std::string body(300, 'b');
+    const std::string pipelined = "GET /next HTTP/1.1\r\n\r\n";
+
+    request += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body + pipelined;
+
+    const message_log expected = parse_in_reads(request.data(), request.size(), request.size());
+
+    assert(expected.need_input == 1);
+    assert(expected.headers == 41);
+    assert(expected.body == body);
+    assert(expected.rest == pipelined);
+
+    for(std::size_t chunk = 1; chunk < request.size(); chunk++) {
+        const message_log actual = parse_in_reads(request.data(), request.size(), chunk);
+
+        // more reads were needed whenever the message did not arrive in one
+        assert(actual.need_input > 1 || chunk >= request.size() - pipelined.size());
+        assert(actual.events == expected.events);
+        assert(actual.body == body);
+
+        // the leftover is whatever the last read brought in after the body
+        assert(pipelined.compare(0, actual.rest.size(), actual.rest) == 0);
+    }
+
+    printf("split input check passed (%zu read sizes, %d headers)\n", request.size() - 1, expected.headers);
+    fflush(stdout);
+}
+
+/* <<< End Split input check */
+
+/* >>> Allocation failure check */
+
+void check_allocation_failure() {
+    char storage[64];
+    ahttp::input_buffer input(storage, sizeof(storage));
+
+    // the arena is already in use by another stream
+    ahttp::frame_arena<> arena;
+    ahttp::event_stream first = ahttp::parse(arena, input, HTTP_PARSER_REQUEST);
+    ahttp::event_stream second = ahttp::parse(arena, input, HTTP_PARSER_REQUEST);
+
+    assert(first.valid() && !second.valid());
+
+    // the arena is too small for the frame
+    ahttp::frame_arena<64> small_arena;
+    ahttp::event_stream third = ahttp::parse(small_arena, input, HTTP_PARSER_REQUEST);
+
+    assert(!third.valid());
+
+    for(ahttp::event_stream* stream : { &second, &third }) {
+        int count = 0;
+
+        for(const ahttp::event& ev : *stream) {
+            assert(ev.type == ahttp::event_type::error);
+            count++;
+        }
+
+        assert(count == 1);
+    }
+
+    // the slot is free again once the first stream is gone
+    first = ahttp::event_stream(std::move(second));
+    assert(ahttp::parse(arena, input, HTTP_PARSER_REQUEST).valid());
+
+    printf("allocation failure check passed\n");
+    fflush(stdout);
+}
+
+/* <<< End Allocation failure check */
+
+/* >>> Framing header check */
+
+// parses `source` in one read, returns the message of the error event or "" if there was none
+std::string_view parse_error(const char* source) {
+    char storage[512];
+    ahttp::input_buffer input(storage, sizeof(storage));
+    ahttp::frame_arena<> arena;
+
+    memcpy(input.prepare(), source, strlen(source));
+    input.commit(strlen(source));
+
+    for(const ahttp::event& ev : ahttp::parse(arena, input, HTTP_PARSER_REQUEST)) {
+        assert(ev.type != ahttp::event_type::need_input);
+
+        if(ev.type == ahttp::event_type::error) {
+            return ev.value;
+        }
+    }
+
+    return "";
+}
+
+void check_framing_headers() {
+    assert(parse_error("POST / HTTP/1.1\r\nContent-Length: 2\r\nContent-Length: 2\r\n\r\nok") == "");
+    assert(parse_error("POST / HTTP/1.1\r\nContent-Length: 2\r\nContent-Length: 20\r\n\r\nok") == "Invalid Content-Length");
+    assert(parse_error("POST / HTTP/1.1\r\nContent-Length: x\r\nContent-Length: 2\r\n\r\nok") == "Invalid Content-Length");
+
+    assert(parse_error("POST / HTTP/1.1\r\nTransfer-Encoding: identity\r\nContent-Length: 2\r\n\r\nok") == "");
+    assert(parse_error("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n") == "Transfer-Encoding is not supported");
+    assert(parse_error("POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n") == "Transfer-Encoding is not supported");
+
+    printf("framing header check passed\n");
+    fflush(stdout);
+}
+
+/* <<< End Framing header check */
+
+int main() {
+
+    check_frame_size();
+    check_split_input();
+    check_keep_alive();
+    check_framing_headers();
+    check_allocation_failure();
+
+    return 0;
+}
@@ -0,0 +1,602 @@
+#define _GNU_SOURCE
+
+// must come before errno.h, which turns the parser's errno field into a macro
+#include "ahttp_parser.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+/*
+ * Loopback load harness: an epoll server feeding the bytes to
+ * `http_parser_compact_run` as they are read, and a multi-connection load
+ * generator sending pipelined requests to it. Every round caps the server
+ * reads to a different size, from 1 byte dribbles to 64 KB bursts.
+ *
+ * usage: load [connections] [pipeline] [seconds per round]
+ */
+
+#define MAX_EVENTS 256
+#define CONN_BUFFER_SIZE (128 * 1024)
+#define MAX_SAMPLES (8 * 1024 * 1024)
+
+static const char request[] =
+    "GET /test/ahttp-parser?page=1 HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "DNT: 1\r\n"
+    "Accept-Encoding: gzip, deflate, sdch\r\n"
+    "Accept-Language: ru-RU,ru;q=0.8,en-US;q=0.6,en;q=0.4\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_10_1) "
+    "AppleWebKit/537.36 (KHTML, like Gecko) "
+    "Chrome/39.0.2171.65 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+    "image/webp,*/*;q=0.8\r\n"
+    "Referer: https://github.com/joyent/http-parser\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n\r\n";
+
+static const int request_length = sizeof(request) - 1;
+
+static const char response[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 0\r\n\r\n";
+
+static const int response_length = sizeof(response) - 1;
+
+static const int read_sizes[] = { 1, 7, 64, 1460, 16 * 1024, 64 * 1024 };
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    int err = clock_gettime(CLOCK_MONOTONIC, &ts);
+    assert(err == 0);
+    (void)err;
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void die(const char* what) {
+    perror(what);
+    exit(EXIT_FAILURE);
+}
+
+static void set_nonblocking(int fd) {
+    const int flags = fcntl(fd, F_GETFL, 0);
+
+    if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        die("fcntl");
+    }
+}
+
+static void set_nodelay(int fd) {
+    const int one = 1;
+
+    if(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
+        die("setsockopt");
+    }
+}
+
+static void epoll_add(int epfd, int fd, void* ptr) {
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = ptr;
+
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        die("epoll_ctl");
+    }
+}
+
+/* Writes everything, sleeping until the socket is writable when it is full. */
+static bool write_all(int fd, const char* data, int length) {
+
+    while(length > 0) {
+        const ssize_t written = write(fd, data, length);
+
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            if(errno == EAGAIN) {
+                struct pollfd pfd;
+
+                pfd.fd = fd;
+                pfd.events = POLLOUT;
+
+                if(poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                    return false;
+                }
+
+                continue;
+            }
+
+            return false;
+        }
+
+        data += written;
+        length -= (int)written;
+    }
+
+    return true;
+}
+
+/* >>> Server */
+
+typedef struct server_conn {
+    int fd;
+
+    struct server_conn* prev;
+    struct server_conn* next;
+
+    char buffer[CONN_BUFFER_SIZE];
+    int length;
+
+    http_parser_compact state;
+    int message_start;
+    const char* body;
+} server_conn;
+
+typedef struct server_config {
+    int listen_fd;
+    int stop_fd;
+    int read_size;
+
+    server_conn* conns;
+    uint64_t parsed_requests;
+} server_config;
+
+static void server_on_body(http_parser* parser, const char* at, int length) {
+    (void)length;
+    ((server_conn*)parser->data)->body = at;
+}
+
+static http_parser_settings server_settings = {
+    .on_body = server_on_body
+};
+
+/*
+ * Resumes parsing with the bytes just read and answers to every request that
+ * is now complete. Returns the number of handled requests, or -1 if the peer
+ * went away.
+ */
+static int server_process(server_conn* conn) {
+
+    char out[CONN_BUFFER_SIZE];
+    int out_length = 0;
+    int handled = 0;
+
+    while(conn->message_start < conn->length) {
+        const char* source = conn->buffer + conn->message_start;
+        const int length = conn->length - conn->message_start;
+
+        http_parser_compact_run(&conn->state, source, length, conn,
+                                &server_settings, HTTP_PARSER_REQUEST);
+
+        const http_parser parser = http_parser_restore(&conn->state, source, length);
+
+        if(parser_is_incomplete(&parser)) {
+            break;
+        }
+
+        if(parser_had_error(&parser)) {
+            fprintf(stderr, "parse error: %s\n", parser_get_error(&parser));
+            exit(EXIT_FAILURE);
+        }
+
+        // GET requests have no body: the next one starts where it would be
+        conn->message_start = (int)(conn->body - conn->buffer);
+        conn->state = http_parser_compact_init();
+
+        if(out_length + response_length > (int)sizeof(out)) {
+            if(!write_all(conn->fd, out, out_length)) {
+                return -1;
+            }
+
+            out_length = 0;
+        }
+
+        memcpy(out + out_length, response, response_length);
+        out_length += response_length;
+
+        handled++;
+    }
+
+    if(out_length > 0 && !write_all(conn->fd, out, out_length)) {
+        return -1;
+    }
+
+    // the compact state only holds offsets from the start of the message
+    if(conn->message_start > 0) {
+        memmove(conn->buffer, conn->buffer + conn->message_start,
+                conn->length - conn->message_start);
+
+        conn->length -= conn->message_start;
+        conn->message_start = 0;
+    }
+
+    return handled;
+}
+
+static void server_close(server_config* config, server_conn* conn) {
+
+    if(conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        config->conns = conn->next;
+    }
+
+    if(conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+
+    close(conn->fd);
+    free(conn);
+}
+
+static void* server_run(void* arg) {
+
+    server_config* config = (server_config*)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    const int epfd = epoll_create1(0);
+    if(epfd < 0) {
+        die("epoll_create1");
+    }
+
+    epoll_add(epfd, config->listen_fd, &config->listen_fd);
+    epoll_add(epfd, config->stop_fd, &config->stop_fd);
+
+    for(;;) {
+        const int count = epoll_wait(epfd, events, MAX_EVENTS, -1);
+
+        if(count < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            die("epoll_wait");
+        }
+
+        for(int i = 0; i < count; i++) {
+            void* ptr = events[i].data.ptr;
+
+            if(ptr == &config->stop_fd) {
+                while(config->conns != NULL) {
+                    server_close(config, config->conns);
+                }
+
+                close(epfd);
+                return NULL;
+            }
+
+            if(ptr == &config->listen_fd) {
+                const int fd = accept(config->listen_fd, NULL, NULL);
+                if(fd < 0) {
+                    continue;
+                }
+
+                set_nonblocking(fd);
+                set_nodelay(fd);
+
+                server_conn* conn = (server_conn*)malloc(sizeof(server_conn));
+                assert(conn != NULL);
+
+                conn->fd = fd;
+                conn->length = 0;
+                conn->state = http_parser_compact_init();
+                conn->message_start = 0;
+                conn->body = NULL;
+
+                conn->prev = NULL;
+                conn->next = config->conns;
+                if(conn->next != NULL) {
+                    conn->next->prev = conn;
+                }
+                config->conns = conn;
+
+                epoll_add(epfd, fd, conn);
+                continue;
+            }
+
+            server_conn* conn = (server_conn*)ptr;
+
+            // one capped read per wakeup: epoll is level-triggered and reports the
+            // connection again while bytes are left, so busy ones can't starve the rest
+            int want = CONN_BUFFER_SIZE - conn->length;
+            if(want > config->read_size) {
+                want = config->read_size;
+            }
+
+            const ssize_t n = read(conn->fd, conn->buffer + conn->length, want);
+
+            if(n < 0 && (errno == EAGAIN || errno == EINTR)) {
+                continue;
+            }
+
+            int handled = -1;
+            if(n > 0) {
+                conn->length += (int)n;
+                handled = server_process(conn);
+            }
+
+            if(handled < 0) {
+                // closed by the client or failed
+                server_close(config, conn);
+                continue;
+            }
+
+            config->parsed_requests += handled;
+        }
+    }
+}
+
+/* <<< End Server */
+
+/* >>> Client */
+
+typedef struct client_conn {
+    int fd;
+
+    uint64_t sent_at;
+    int pending;  // responses still expected for the current batch
+    int received; // bytes of the current response received so far
+} client_conn;
+
+typedef struct latency_samples {
+    uint64_t* values;
+    size_t count;
+} latency_samples;
+
+static void client_send_batch(client_conn* conn, const char* batch, int batch_length, int pipeline) {
+    conn->sent_at = now_ns();
+    conn->pending = pipeline;
+    conn->received = 0;
+
+    if(!write_all(conn->fd, batch, batch_length)) {
+        die("write");
+    }
+}
+
+static uint64_t client_run(int port, int connections, int pipeline, double seconds,
+                           latency_samples* samples) {
+
+    struct epoll_event events[MAX_EVENTS];
+    char buffer[64 * 1024];
+
+    // pipelined requests are coalesced in a single write
+    const int batch_length = request_length * pipeline;
+    char* batch = (char*)malloc(batch_length);
+    assert(batch != NULL);
+
+    for(int i = 0; i < pipeline; i++) {
+        memcpy(batch + i * request_length, request, request_length);
+    }
+
+    const int epfd = epoll_create1(0);
+    if(epfd < 0) {
+        die("epoll_create1");
+    }
+
+    client_conn* conns = (client_conn*)calloc(connections, sizeof(client_conn));
+    assert(conns != NULL);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for(int i = 0; i < connections; i++) {
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+        if(fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            die("connect");
+        }
+
+        set_nonblocking(fd);
+        set_nodelay(fd);
+
+        conns[i].fd = fd;
+        epoll_add(epfd, fd, &conns[i]);
+    }
+
+    const uint64_t deadline = now_ns() + (uint64_t)(seconds * 1e9);
+    uint64_t completed = 0;
+
+    for(int i = 0; i < connections; i++) {
+        client_send_batch(&conns[i], batch, batch_length, pipeline);
+    }
+
+    while(now_ns() < deadline) {
+        const int count = epoll_wait(epfd, events, MAX_EVENTS, 100);
+
+        if(count < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            die("epoll_wait");
+        }
+
+        for(int i = 0; i < count; i++) {
+            client_conn* conn = (client_conn*)events[i].data.ptr;
+
+            for(;;) {
+                const ssize_t n = read(conn->fd, buffer, sizeof(buffer));
+
+                if(n < 0 && (errno == EAGAIN || errno == EINTR)) {
+                    break;
+                }
+
+                if(n <= 0) {
+                    die("read");
+                }
+
+                conn->received += (int)n;
+
+                const uint64_t now = now_ns();
+                while(conn->received >= response_length && conn->pending > 0) {
+                    conn->received -= response_length;
+                    conn->pending--;
+                    completed++;
+
+                    if(samples->count < MAX_SAMPLES) {
+                        samples->values[samples->count++] = now - conn->sent_at;
+                    }
+                }
+
+                if(conn->pending == 0) {
+                    client_send_batch(conn, batch, batch_length, pipeline);
+                }
+            }
+        }
+    }
+
+    for(int i = 0; i < connections; i++) {
+        close(conns[i].fd);
+    }
+
+    close(epfd);
+    free(conns);
+    free(batch);
+
+    return completed;
+}
+
+/* <<< End Client */
+
+static int compare_u64(const void* a, const void* b) {
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(const latency_samples* samples, double p) {
+    if(samples->count == 0) {
+        return 0.0;
+    }
+
+    size_t index = (size_t)(p * (double)(samples->count - 1));
+    return (double)samples->values[index] / 1000.0;
+}
+
+static void run_round(int listen_fd, int port, int read_size,
+                      int connections, int pipeline, double seconds,
+                      latency_samples* samples) {
+
+    int stop_pipe[2];
+    if(pipe(stop_pipe) < 0) {
+        die("pipe");
+    }
+
+    server_config config;
+    config.listen_fd = listen_fd;
+    config.stop_fd = stop_pipe[0];
+    config.read_size = read_size;
+    config.conns = NULL;
+    config.parsed_requests = 0;
+
+    pthread_t server;
+    if(pthread_create(&server, NULL, server_run, &config) != 0) {
+        die("pthread_create");
+    }
+
+    samples->count = 0;
+    const uint64_t start = now_ns();
+    const uint64_t completed = client_run(port, connections, pipeline, seconds, samples);
+    const double elapsed = (double)(now_ns() - start) * 1e-9;
+
+    write_all(stop_pipe[1], "x", 1);
+    pthread_join(server, NULL);
+
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+
+    qsort(samples->values, samples->count, sizeof(uint64_t), compare_u64);
+
+    printf("%-7d | %12.2f | %10.1f | %10.1f | %10.1f | %llu\n",
+           read_size,
+           (double)completed / elapsed,
+           percentile_us(samples, 0.50),
+           percentile_us(samples, 0.99),
+           percentile_us(samples, 0.999),
+           (unsigned long long)config.parsed_requests);
+
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+
+    const int connections = argc > 1 ? atoi(argv[1]) : 64;
+    const int pipeline = argc > 2 ? atoi(argv[2]) : 8;
+    const double seconds = argc > 3 ? atof(argv[3]) : 2.0;
+
+    if(connections <= 0 || pipeline <= 0 || seconds <= 0
+       || request_length * pipeline > CONN_BUFFER_SIZE) {
+        fprintf(stderr, "usage: %s [connections] [pipeline] [seconds per round]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // the server may still answer connections the client already closed
+    signal(SIGPIPE, SIG_IGN);
+
+    const int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(listen_fd < 0) {
+        die("socket");
+    }
+
+    const int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    socklen_t addr_length = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0; // any free port
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if(bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+       || listen(listen_fd, SOMAXCONN) < 0
+       || getsockname(listen_fd, (struct sockaddr*)&addr, &addr_length) < 0) {
+        die("listen");
+    }
+
+    set_nonblocking(listen_fd);
+
+    latency_samples samples;
+    samples.values = (uint64_t*)malloc(MAX_SAMPLES * sizeof(uint64_t));
+    samples.count = 0;
+    assert(samples.values != NULL);
+
+    printf("request length = %d, connections = %d, pipeline = %d\n",
+           request_length, connections, pipeline);
+    printf("read    |      req/sec |   p50 (us) |   p99 (us) |  p999 (us) | parsed\n");
+
+    for(size_t i = 0; i < sizeof(read_sizes) / sizeof(read_sizes[0]); i++) {
+        run_round(listen_fd, ntohs(addr.sin_port), read_sizes[i],
+                  connections, pipeline, seconds, &samples);
+    }
+
+    free(samples.values);
+    close(listen_fd);
+
+    return 0;
+}